@@ -11,6 +11,8 @@
 #include <sstream>
 #include <cmath>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
 
 // Sets/Resets all fields to zero
 void WavFile::init(){
@@ -130,7 +132,7 @@ void WavFile::normalizeSamples(){
 
 // Turns a 3 byte char array into a 32 bit int
 // The ternary operator decides if sign extension is necessary
-inline int32_t int24to32(unsigned char *in){
+inline int32_t int24to32(const unsigned char *in){
     return ((in[2] & 0x80) ? (0xff <<24) : 0) | (in[2] << 16) | (in[1] << 8) | in[0];
 }
 
@@ -139,6 +141,36 @@ const float uint8normalize = 2.0f/0xff; // Maps to [0,2], subtract 1 afterwards!
 const float int16normalize = 1.0f/0x7fff;
 const float int24normalize = 1.0f / 8388607.0; // Magic number, maps smallest to -1 and largest to 1
 
+// Decodes interleaved linear PCM frames into separate channel arrays
+// out holds one array per channel, each with room for frames samples
+void WavFile::decodeFrames(const unsigned char *data, uint32_t frames, uint16_t channels, uint16_t bits, float **out){
+    for (uint32_t sample = 0; sample < frames; ++sample) {
+        for(int channel = 0; channel < channels; ++channel){
+            if (bits == 8) {
+                // Subtract one because the normalization factor maps to [0,2] and not [-1,1]
+                out[channel][sample] = uint8normalize*(float)data[0] - 1;
+                data += 1;
+                
+            } else if (bits == 16) {
+                int16_t temp16bit = (int16_t)(data[0] | (data[1] << 8));
+                out[channel][sample] = int16normalize*(float)temp16bit;
+                data += 2;
+                
+            } else if (bits == 24) {
+                // There is no 24 bit variable in c++, so must use a 3 byte unsigned char array
+                int32_t temp = int24to32(data); // Convert the unsigned char into a 32-bit int
+                out[channel][sample] = int24normalize*(float)temp; // Convert 32-bit int to float
+                data += 3;
+                
+            } else {
+                // Unsupported sample size, leave silence rather than garbage
+                out[channel][sample] = 0;
+                data += bits/8;
+            }
+        }
+    }
+}
+
 // Open a new wav file
 // Deallocates old file if necessary
 void WavFile::open(std::string path){
@@ -244,7 +276,7 @@ void WavFile::open(std::string path){
                 
                 break;
                 
-            case WavChunks::Data:
+            case WavChunks::Data: {
                 // Data Subchunk that stores the data
                 // Structure:
                 // 4 byte datasize
@@ -252,8 +284,19 @@ void WavFile::open(std::string path){
                 
                 uint32_t datasize;
                 f.read(reinterpret_cast<char*>(&datasize), sizeof(datasize));
+                
+                // Files that are still being recorded (or never got finalized) have a placeholder
+                // datasize of 0 or 0xFFFFFFFF, so fall back to the bytes actually in the file
+                std::streamoff data_start = f.tellg();
+                f.seekg(0, std::ios::end);
+                uint64_t available = (uint64_t)(f.tellg() - data_start);
+                f.seekg(data_start);
+                if (datasize == 0 || datasize == 0xFFFFFFFF || datasize > available) {
+                    datasize = (uint32_t)std::min<uint64_t>(available, 0xFFFFFFFF);
+                }
+                
                 samples = new float*[num_channels];
-                num_samples =datasize*8/num_channels/bits_per_sample; // calculate number of samples
+                num_samples = (uint32_t)((uint64_t)datasize*8/num_channels/bits_per_sample); // calculate number of samples
                 
                 for (int channel = 0; channel < num_channels; ++channel) {
                     samples[channel] = new float[num_samples];
@@ -262,33 +305,26 @@ void WavFile::open(std::string path){
                 // For linear PCM data:
                 // Data is stored as a sequence of packets
                 // each packet contains one sample for all channels
+                // Read a block of packets at a time and decode them together
+                
+                const uint32_t frame_bytes = num_channels*(bits_per_sample/8);
+                const uint32_t block_frames = 4096;
+                std::vector<unsigned char> block((size_t)block_frames*frame_bytes);
+                std::vector<float*> out(num_channels);
                 
-                for (int sample = 0; sample < num_samples; ++sample) {
+                for (uint32_t sample = 0; sample < num_samples; sample += block_frames) {
+                    uint32_t frames = std::min(block_frames, num_samples - sample);
+                    f.read(reinterpret_cast<char*>(block.data()), (std::streamsize)frames*frame_bytes);
                     for(int channel = 0; channel < num_channels; ++channel){
-                        if (bits_per_sample == 8) {
-                            uint8_t temp8bit;
-                            f.read(reinterpret_cast<char*>(&temp8bit), sizeof(temp8bit));
-                            
-                            // Subtract one because the normalization factor maps to [0,2] and not [-1,1]
-                            samples[channel][sample] = uint8normalize*(float)temp8bit - 1;
-                            
-                        } else if (bits_per_sample == 16) {
-                            int16_t temp16bit;
-                            f.read(reinterpret_cast<char*>(&temp16bit), sizeof(temp16bit));
-                            
-                            samples[channel][sample] = int16normalize*(float)temp16bit;
-                        } else if (bits_per_sample == 24) {
-                            
-                            // There is no 24 bit variable in c++, so must use a 3 byte unsigned char array
-                            unsigned char temp24bit[3] = {0,0,0};
-                            f.read((char*)temp24bit, 3);
-                            
-                            int32_t temp = int24to32(temp24bit); // Convert the unsigned char into a 32-bit int
-                            samples[channel][sample] = int24normalize*(float)temp; // Convert 32-bit int to float
-                        }
+                        out[channel] = samples[channel] + sample;
                     }
+                    decodeFrames(block.data(), frames, num_channels, bits_per_sample, out.data());
                 }
+                
+                // Skip anything left over after the last whole frame
+                f.seekg(data_start + (std::streamoff)datasize);
                 break;
+            }
                 
             default:
                 // Some other chunk that we don't handle, just log it
@@ -342,6 +378,23 @@ float ** WavFile::getData(){
     return samples;
 }
 
+// Replace the sample arrays with already processed data
+// Takes ownership of data, which must be allocated with new[] like the samples array
+void WavFile::replaceData(float **data, uint16_t channels, uint32_t length){
+    freeSamples();
+    samples = data;
+    num_channels = channels;
+    num_samples = length;
+    block_align = channels*bits_per_sample/8;
+    byte_rate = sample_rate*block_align;
+}
+
+// Change the sample rate, for data that has been resampled
+void WavFile::setSampleRate(uint32_t rate){
+    sample_rate = rate;
+    byte_rate = sample_rate*block_align;
+}
+
 // Convert the format id into a string for display purposes
 std::string audioFormatToString(WavFormat n){
     switch (n) {
@@ -47,6 +47,15 @@ public:
     uint32_t getNumSamples();
     float ** getData();
     
+    // Replace the sample arrays with already processed data
+    // Takes ownership of data, which must be allocated with new[] like the samples array
+    // Channel dependent fields (block align, byte rate) are updated to match
+    void replaceData(float **data, uint16_t channels, uint32_t length);
+    
+    // Change the sample rate, for data that has been resampled
+    // Updates the byte rate to match
+    void setSampleRate(uint32_t rate);
+    
     // Operator to access individual channels
     float *operator[](int index){
         if(index < 0 || index >= num_channels){
@@ -64,6 +73,10 @@ public:
     // Ensures the highest sample peaks at +-1
     void normalizeSamples();
     
+    // Decodes interleaved linear PCM frames (8, 16 or 24 bit) into separate channel arrays
+    // out holds one array per channel, each with room for frames samples
+    static void decodeFrames(const unsigned char *data, uint32_t frames, uint16_t channels, uint16_t bits, float **out);
+    
 protected:
 private:
     void init(); // Sets/Resets all fields to zero
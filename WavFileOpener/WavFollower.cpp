@@ -0,0 +1,281 @@
+//
+//  WavFollower.cpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavFollower.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+// Chunk ids, in big endian like WavFile reads them
+static const uint32_t riff_chunk_id = 0x52494646; // 'RIFF'
+static const uint32_t wave_format_id = 0x57415645; // 'WAVE'
+static const uint32_t format_chunk_id = 0x666D7420; // 'fmt '
+static const uint32_t data_chunk_id = 0x64617461; // 'data'
+
+// Most frames decoded at once, bounds the read buffers when catching up on a long file
+static const uint32_t max_frames_per_read = 1 << 14;
+
+// Placeholder data sizes recorders leave until they finish
+static bool isPlaceholderSize(uint32_t size){
+    return size == 0 || size == 0xFFFFFFFF;
+}
+
+// Sets/Resets all fields to zero
+void WavFollower::init(){
+    format = 0;
+    num_channels = 0;
+    sample_rate = 0;
+    bits_per_sample = 0;
+    frame_bytes = 0;
+    ready = false;
+    finalized = false;
+    datasize_offset = 0;
+    data_offset = 0;
+    bytes_read = 0;
+    num_samples = 0;
+    stopping = false;
+    kept.clear();
+    decoded.clear();
+}
+
+// Default Constructor
+WavFollower::WavFollower(){
+    keep_samples = true;
+    init();
+}
+
+// Constructor
+// Starts following the specified wav file
+WavFollower::WavFollower(std::string path){
+    keep_samples = true;
+    init();
+    open(path);
+}
+
+// Start following a new wav file
+void WavFollower::open(std::string path){
+    close();
+
+    this->path = path;
+    unsigned long i = path.rfind('/');
+    if (i != std::string::npos){
+        filename = path.substr(i+1, path.length()-1);
+    } else {
+        filename = path;
+    }
+
+    f.open(path, std::ios::binary);
+    if(!f.is_open()){
+        throw std::runtime_error("WavFollower Error: Could not open file\n");
+    }
+
+    readHeader();
+}
+
+// Stop following the file and drop any kept samples
+void WavFollower::close(){
+    if(f.is_open()){
+        f.close();
+    }
+    f.clear();
+    init();
+}
+
+// Reads the header up to the start of the data chunk
+// Returns false if the recorder hasn't written all of it yet
+bool WavFollower::readHeader(){
+    f.clear();
+    f.seekg(0, std::ios::end);
+    uint64_t size = (uint64_t)f.tellg();
+    if(size < 12){
+        return false;
+    }
+
+    uint32_t chunkid;
+    uint32_t chunksize;
+    uint32_t format_specifier;
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(&chunkid), sizeof(chunkid));
+    f.read(reinterpret_cast<char*>(&chunksize), sizeof(chunksize));
+    f.read(reinterpret_cast<char*>(&format_specifier), sizeof(format_specifier));
+    if(__builtin_bswap32(chunkid) != riff_chunk_id || __builtin_bswap32(format_specifier) != wave_format_id){
+        throw std::runtime_error("WavFollower Error: Not a Wave File!");
+    }
+
+    // Walk the chunks until the data chunk
+    uint64_t position = 12;
+    bool have_format = false;
+    while(position + 8 <= size){
+        f.seekg(position);
+        f.read(reinterpret_cast<char*>(&chunkid), sizeof(chunkid));
+        f.read(reinterpret_cast<char*>(&chunksize), sizeof(chunksize));
+        chunkid = __builtin_bswap32(chunkid);
+
+        if(chunkid == format_chunk_id){
+            if(position + 8 + 16 > size){
+                return false;
+            }
+            uint32_t byte_rate;
+            uint16_t block_align;
+            f.read(reinterpret_cast<char*>(&format), sizeof(format));
+            f.read(reinterpret_cast<char*>(&num_channels), sizeof(num_channels));
+            f.read(reinterpret_cast<char*>(&sample_rate), sizeof(sample_rate));
+            f.read(reinterpret_cast<char*>(&byte_rate), sizeof(byte_rate));
+            f.read(reinterpret_cast<char*>(&block_align), sizeof(block_align));
+            f.read(reinterpret_cast<char*>(&bits_per_sample), sizeof(bits_per_sample));
+            have_format = true;
+
+        } else if(chunkid == data_chunk_id){
+            if(!have_format){
+                throw std::runtime_error("WavFollower Error: Data chunk before format chunk!");
+            }
+            if(num_channels == 0 || (bits_per_sample != 8 && bits_per_sample != 16 && bits_per_sample != 24)){
+                throw std::runtime_error("WavFollower Error: Unsupported sample format!");
+            }
+
+            frame_bytes = num_channels*(bits_per_sample/8);
+            datasize_offset = position + 4;
+            data_offset = position + 8;
+            kept.assign(num_channels, std::vector<float>());
+            decoded.assign(num_channels, std::vector<float>());
+            ready = true;
+            return true;
+        }
+
+        // Skip the chunk, chunks are padded to an even size
+        position += 8 + (uint64_t)chunksize + (chunksize & 1);
+    }
+
+    return false;
+}
+
+// Check the file for appended data and decode any new whole frames
+// Returns the number of new samples per channel
+uint32_t WavFollower::poll(){
+    if(!f.is_open()){
+        return 0;
+    }
+    if(!ready && !readHeader()){
+        return 0;
+    }
+
+    // Everything after the data chunk header counts as data while recording
+    f.clear();
+    f.seekg(0, std::ios::end);
+    uint64_t size = (uint64_t)f.tellg();
+    uint64_t limit = size > data_offset ? size - data_offset : 0;
+
+    // Once the recorder writes the real size, stop there
+    uint32_t datasize = 0;
+    f.seekg(datasize_offset);
+    f.read(reinterpret_cast<char*>(&datasize), sizeof(datasize));
+    bool final_size = !isPlaceholderSize(datasize) && datasize >= bytes_read && datasize <= limit;
+    if(final_size){
+        limit = datasize;
+    }
+
+    uint32_t total = 0;
+    while(limit - bytes_read >= frame_bytes){
+        uint32_t frames = (uint32_t)std::min<uint64_t>((limit - bytes_read)/frame_bytes, max_frames_per_read);
+
+        raw.resize((size_t)frames*frame_bytes);
+        f.clear();
+        f.seekg(data_offset + bytes_read);
+        f.read(reinterpret_cast<char*>(raw.data()), (std::streamsize)raw.size());
+        frames = (uint32_t)(f.gcount()/frame_bytes);
+        if(frames == 0){
+            break;
+        }
+
+        std::vector<float*> out(num_channels);
+        for(int channel = 0; channel < num_channels; ++channel){
+            decoded[channel].resize(frames);
+            out[channel] = decoded[channel].data();
+        }
+        WavFile::decodeFrames(raw.data(), frames, num_channels, bits_per_sample, out.data());
+
+        if(callback){
+            callback(out.data(), num_channels, frames);
+        }
+        if(keep_samples){
+            for(int channel = 0; channel < num_channels; ++channel){
+                kept[channel].insert(kept[channel].end(), out[channel], out[channel] + frames);
+            }
+        }
+
+        bytes_read += (uint64_t)frames*frame_bytes;
+        num_samples += frames;
+        total += frames;
+    }
+
+    finalized = final_size && limit - bytes_read < frame_bytes;
+    return total;
+}
+
+// Poll in a loop until stop() is called, sleeping interval whenever nothing new arrived
+void WavFollower::run(std::chrono::milliseconds interval){
+    while(!stopping){
+        if(poll() == 0){
+            std::this_thread::sleep_for(interval);
+        }
+    }
+    stopping = false;
+}
+
+// Makes run() return after its current poll
+void WavFollower::stop(){
+    stopping = true;
+}
+
+void WavFollower::setCallback(Callback callback){
+    this->callback = callback;
+}
+
+void WavFollower::setKeepSamples(bool keep){
+    keep_samples = keep;
+}
+
+// Getters
+bool WavFollower::isReady(){
+    return ready;
+}
+
+bool WavFollower::isFinalized(){
+    return finalized;
+}
+
+std::string WavFollower::getFileName(){
+    return filename;
+}
+
+uint16_t WavFollower::getFormat(){
+    return format;
+}
+
+uint16_t WavFollower::getNumChannels(){
+    return num_channels;
+}
+
+uint32_t WavFollower::getSampleRate(){
+    return sample_rate;
+}
+
+uint16_t WavFollower::getBitsPerSample(){
+    return bits_per_sample;
+}
+
+uint64_t WavFollower::getNumSamples(){
+    return num_samples;
+}
+
+const std::vector<float> &WavFollower::getChannel(int index){
+    if(index < 0 || index >= num_channels){
+        throw std::out_of_range("Tried to access a channel that doesn't exist!");
+    }
+    return kept[index];
+}
@@ -0,0 +1,112 @@
+//
+//  WavFollower.hpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavFollower_hpp
+#define WavFollower_hpp
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "WavFile.hpp"
+
+/* WavFollower class
+ *
+ * Follows a wav file that is still being recorded, like tail -f
+ *
+ * Recorders usually only patch the RIFF and data sizes once they finish, leaving 0 or
+ * 0xFFFFFFFF until then. The follower ignores those placeholders and treats the data chunk
+ * as running to the end of the file. Every poll checks the file size, then reads and
+ * decodes only the whole frames appended since the last one. New samples go to a callback,
+ * and are also kept in a growing buffer unless setKeepSamples(false) is called.
+ *
+ * Once the recorder writes a real data size, reading stops there, so chunks appended
+ * after the data (LIST etc.) are not decoded as audio.
+ */
+class WavFollower {
+public:
+
+    // Called with the newly decoded samples, one array per channel
+    // The arrays are only valid during the call
+    typedef std::function<void(float **samples, uint16_t channels, uint32_t length)> Callback;
+
+    // Default Constructor
+    WavFollower();
+
+    // Constructor
+    // Starts following the specified wav file
+    WavFollower(std::string path);
+
+    // Start following a new wav file
+    // The header may still be missing, it is read by a later poll once it has been written
+    void open(std::string path);
+
+    // Stop following the file and drop any kept samples
+    void close();
+
+    // Check the file for appended data and decode any new whole frames
+    // Returns the number of new samples per channel
+    uint32_t poll();
+
+    // Poll in a loop until stop() is called, sleeping interval whenever nothing new arrived
+    // Meant to run on its own thread, so use the callback rather than the kept samples
+    void run(std::chrono::milliseconds interval = std::chrono::milliseconds(50));
+
+    // Makes run() return after its current poll, safe to call from any thread
+    void stop();
+
+    void setCallback(Callback callback);
+    void setKeepSamples(bool keep);
+
+    // Getters
+    // Format fields are zero until the header has been read
+    bool isReady(); // The header has been read and samples are being decoded
+    bool isFinalized(); // The recorder has written the real data size and all of it has been decoded
+    std::string getFileName();
+    uint16_t getFormat();
+    uint16_t getNumChannels();
+    uint32_t getSampleRate();
+    uint16_t getBitsPerSample();
+    uint64_t getNumSamples(); // Samples per channel decoded so far
+    const std::vector<float> &getChannel(int index); // Kept samples of a channel
+
+private:
+    void init(); // Sets/Resets all fields to zero
+    bool readHeader(); // Reads the header up to the data chunk, returns false if it isn't all there yet
+
+    std::string path;
+    std::string filename;
+    std::ifstream f;
+
+    uint16_t format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint16_t bits_per_sample;
+    uint32_t frame_bytes; // Bytes per frame of all channels
+
+    bool ready;
+    bool finalized;
+    uint64_t datasize_offset; // Position of the data size field
+    uint64_t data_offset; // Position of the first sample
+    uint64_t bytes_read; // Bytes of sample data consumed so far
+    uint64_t num_samples;
+
+    Callback callback;
+    bool keep_samples;
+    std::atomic<bool> stopping;
+
+    std::vector<std::vector<float> > kept; // Growing buffers, one per channel
+    std::vector<unsigned char> raw; // Reused read buffer
+    std::vector<std::vector<float> > decoded; // Reused decode buffers, one per channel
+};
+
+#endif /* WavFollower_hpp */
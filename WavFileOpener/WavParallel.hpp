@@ -0,0 +1,67 @@
+//
+//  WavParallel.hpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavParallel_hpp
+#define WavParallel_hpp
+
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Number of threads worth using for a job of the given size
+// Small jobs stay on the calling thread, spawning threads would cost more than it saves
+inline unsigned int workerCount(uint64_t work, uint64_t min_work_per_thread = 1 << 16){
+    unsigned int hardware = std::thread::hardware_concurrency();
+    if(hardware == 0){
+        hardware = 1;
+    }
+    uint64_t by_work = work / min_work_per_thread;
+    if(by_work < 1){
+        by_work = 1;
+    }
+    return (unsigned int)std::min<uint64_t>(hardware, by_work);
+}
+
+// Splits [0, count) into contiguous ranges and calls fn(worker, begin, end) for each
+// The last range runs on the calling thread, the rest on their own threads
+// fn must not throw
+template <typename Function>
+void parallelFor(uint32_t count, unsigned int workers, Function fn){
+    if(workers > count){
+        workers = count;
+    }
+    if(workers <= 1){
+        if(count > 0){
+            fn(0u, 0u, count);
+        }
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+
+    uint32_t step = count / workers;
+    uint32_t extra = count % workers;
+    uint32_t begin = 0;
+    for(unsigned int worker = 0; worker < workers; ++worker){
+        uint32_t end = begin + step + (worker < extra ? 1 : 0);
+        if(worker == workers - 1){
+            fn(worker, begin, end);
+        } else {
+            threads.emplace_back(fn, worker, begin, end);
+        }
+        begin = end;
+    }
+
+    for(auto &t : threads){
+        t.join();
+    }
+}
+
+#endif /* WavParallel_hpp */
@@ -0,0 +1,280 @@
+//
+//  WavProcessor.cpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavProcessor.hpp"
+#include "WavParallel.hpp"
+#include <cmath>
+#include <stdexcept>
+
+// Samples per block of the fused pass
+// Small enough that a block of every input channel stays in L1 while each output channel is built
+static const uint32_t block_size = 1024;
+
+// Default Constructor
+// Creates an empty chain, which just copies the samples
+WavProcessor::WavProcessor(){
+    count_clipping = false;
+    clip_threshold = 1.0f;
+    clipped_samples = 0;
+}
+
+// Multiply all channels by factor
+WavProcessor &WavProcessor::gain(float factor){
+    Operation op = {Step::Gain, factor, std::vector<int>()};
+    operations.push_back(op);
+    return *this;
+}
+
+// Subtract the mean of each channel
+WavProcessor &WavProcessor::removeDCOffset(){
+    Operation op = {Step::RemoveDCOffset, 0, std::vector<int>()};
+    operations.push_back(op);
+    return *this;
+}
+
+// Average all channels into one
+WavProcessor &WavProcessor::mixToMono(){
+    Operation op = {Step::MixToMono, 0, std::vector<int>()};
+    operations.push_back(op);
+    return *this;
+}
+
+// Output channel i is input channel map[i]
+// Channels may be repeated or dropped
+WavProcessor &WavProcessor::remapChannels(const std::vector<int> &map){
+    if(map.empty()){
+        throw std::invalid_argument("WavProcessor Error: Channel map is empty!");
+    }
+    Operation op = {Step::Remap, 0, map};
+    operations.push_back(op);
+    return *this;
+}
+
+// Keep only one channel
+WavProcessor &WavProcessor::extractChannel(int channel){
+    return remapChannels(std::vector<int>(1, channel));
+}
+
+// Count output samples whose magnitude reaches threshold
+WavProcessor &WavProcessor::countClipping(float threshold){
+    count_clipping = true;
+    clip_threshold = threshold;
+    return *this;
+}
+
+// Remove all operations from the chain
+void WavProcessor::clear(){
+    operations.clear();
+    count_clipping = false;
+    clip_threshold = 1.0f;
+    clipped_samples = 0;
+}
+
+// Number of channels the chain produces from in_channels input channels
+uint16_t WavProcessor::getOutputChannels(uint16_t in_channels){
+    uint16_t channels = in_channels;
+    for(auto &op : operations){
+        if(op.step == Step::MixToMono){
+            channels = 1;
+        } else if(op.step == Step::Remap){
+            channels = (uint16_t)op.map.size();
+        }
+    }
+    return channels;
+}
+
+uint64_t WavProcessor::getClippedSamples(){
+    return clipped_samples;
+}
+
+// Collapses the chain into a single matrix and offset
+// The signal after any number of steps is matrix*input + offset, so each step only rewrites those
+void WavProcessor::compile(float **in, uint16_t in_channels, uint32_t length,
+                           std::vector<float> &matrix, std::vector<float> &offset){
+
+    // Start with the identity
+    uint16_t channels = in_channels;
+    matrix.assign((size_t)channels*in_channels, 0.0f);
+    offset.assign(channels, 0.0f);
+    for(int channel = 0; channel < channels; ++channel){
+        matrix[(size_t)channel*in_channels + channel] = 1.0f;
+    }
+
+    // Means of the input channels, only computed if the chain removes DC offset
+    std::vector<double> means;
+
+    for(auto &op : operations){
+        switch(op.step){
+            case Step::Gain:
+                for(auto &m : matrix){
+                    m *= op.factor;
+                }
+                for(auto &b : offset){
+                    b *= op.factor;
+                }
+                break;
+
+            case Step::RemoveDCOffset: {
+                if(means.empty()){
+                    means.assign(in_channels, 0.0);
+                    unsigned int workers = workerCount((uint64_t)length*in_channels);
+                    std::vector<double> partial((size_t)workers*in_channels, 0.0);
+
+                    parallelFor(length, workers, [&](unsigned int worker, uint32_t begin, uint32_t end){
+                        for(int channel = 0; channel < in_channels; ++channel){
+                            const float *src = in[channel];
+
+                            // Sum each block in float so it vectorizes, accumulate blocks in double
+                            double sum = 0;
+                            for(uint32_t start = begin; start < end; start += block_size){
+                                uint32_t stop = std::min(end, start + block_size);
+                                float block_sum = 0;
+                                for(uint32_t sample = start; sample < stop; ++sample){
+                                    block_sum += src[sample];
+                                }
+                                sum += block_sum;
+                            }
+                            partial[(size_t)worker*in_channels + channel] = sum;
+                        }
+                    });
+
+                    for(unsigned int worker = 0; worker < workers; ++worker){
+                        for(int channel = 0; channel < in_channels; ++channel){
+                            means[channel] += partial[(size_t)worker*in_channels + channel];
+                        }
+                    }
+                    for(auto &mean : means){
+                        mean = length ? mean / length : 0.0;
+                    }
+                }
+
+                // The mean at this point of the chain follows from the input means
+                for(int channel = 0; channel < channels; ++channel){
+                    double mean = offset[channel];
+                    for(int input = 0; input < in_channels; ++input){
+                        mean += matrix[(size_t)channel*in_channels + input] * means[input];
+                    }
+                    offset[channel] -= (float)mean;
+                }
+                break;
+            }
+
+            case Step::MixToMono: {
+                std::vector<float> mixed(in_channels, 0.0f);
+                float mixed_offset = 0;
+                for(int channel = 0; channel < channels; ++channel){
+                    for(int input = 0; input < in_channels; ++input){
+                        mixed[input] += matrix[(size_t)channel*in_channels + input] / channels;
+                    }
+                    mixed_offset += offset[channel] / channels;
+                }
+                channels = 1;
+                matrix.swap(mixed);
+                offset.assign(1, mixed_offset);
+                break;
+            }
+
+            case Step::Remap: {
+                std::vector<float> remapped;
+                std::vector<float> remapped_offset;
+                for(int source : op.map){
+                    if(source < 0 || source >= channels){
+                        throw std::out_of_range("WavProcessor Error: Tried to map a channel that doesn't exist!");
+                    }
+                    remapped.insert(remapped.end(),
+                                    matrix.begin() + (size_t)source*in_channels,
+                                    matrix.begin() + (size_t)(source + 1)*in_channels);
+                    remapped_offset.push_back(offset[source]);
+                }
+                channels = (uint16_t)op.map.size();
+                matrix.swap(remapped);
+                offset.swap(remapped_offset);
+                break;
+            }
+        }
+    }
+}
+
+// Apply the chain to raw channel arrays
+// out must hold getOutputChannels(in_channels) arrays of length samples, and must not alias in
+void WavProcessor::process(float **in, uint16_t in_channels, uint32_t length, float **out){
+    std::vector<float> matrix;
+    std::vector<float> offset;
+    compile(in, in_channels, length, matrix, offset);
+
+    const uint16_t out_channels = (uint16_t)offset.size();
+    const bool clipping = count_clipping;
+    const float threshold = clip_threshold;
+
+    unsigned int workers = workerCount((uint64_t)length*(in_channels + out_channels));
+    std::vector<uint64_t> clipped(workers, 0);
+
+    // One pass over the samples, a block at a time
+    // Every output channel of a block is built while that block of input is still in cache
+    parallelFor(length, workers, [&](unsigned int worker, uint32_t begin, uint32_t end){
+        uint64_t count = 0;
+        for(uint32_t start = begin; start < end; start += block_size){
+            uint32_t n = std::min(end, start + block_size) - start;
+
+            for(int channel = 0; channel < out_channels; ++channel){
+                float * __restrict dst = out[channel] + start;
+                const float bias = offset[channel];
+                for(uint32_t i = 0; i < n; ++i){
+                    dst[i] = bias;
+                }
+                for(int input = 0; input < in_channels; ++input){
+                    const float weight = matrix[(size_t)channel*in_channels + input];
+                    if(weight == 0.0f){
+                        continue;
+                    }
+                    const float * __restrict src = in[input] + start;
+                    for(uint32_t i = 0; i < n; ++i){
+                        dst[i] += weight*src[i];
+                    }
+                }
+                if(clipping){
+                    uint32_t block_count = 0;
+                    for(uint32_t i = 0; i < n; ++i){
+                        block_count += std::fabs(dst[i]) >= threshold;
+                    }
+                    count += block_count;
+                }
+            }
+        }
+        clipped[worker] = count;
+    });
+
+    clipped_samples = 0;
+    for(auto c : clipped){
+        clipped_samples += c;
+    }
+}
+
+// Apply the chain to a loaded wav file, replacing its samples
+void WavProcessor::apply(WavFile &w){
+    uint16_t in_channels = w.getNumChannels();
+    uint32_t length = w.getNumSamples();
+    uint16_t out_channels = getOutputChannels(in_channels);
+
+    float **out = new float*[out_channels];
+    for(int channel = 0; channel < out_channels; ++channel){
+        out[channel] = new float[length];
+    }
+
+    try {
+        process(w.getData(), in_channels, length, out);
+    } catch(...) {
+        for(int channel = 0; channel < out_channels; ++channel){
+            delete [] out[channel];
+        }
+        delete [] out;
+        throw;
+    }
+
+    w.replaceData(out, out_channels, length);
+}
@@ -0,0 +1,91 @@
+//
+//  WavProcessor.hpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavProcessor_hpp
+#define WavProcessor_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "WavFile.hpp"
+
+/* WavProcessor class
+ *
+ * A chain of sample operations (gain, DC offset removal, mix down, channel remap/extract)
+ * that is applied to a WavFile in a single fused pass over the samples.
+ *
+ * Every operation is linear, so the chain collapses into one channel matrix plus an offset
+ * per output channel. Applying it reads each input sample once, split across threads by
+ * sample range, with the inner loops written so the compiler vectorizes them.
+ * Removing DC offset needs the channel means first, which costs one extra read-only pass.
+ *
+ * Usage:
+ *     WavProcessor p;
+ *     p.removeDCOffset().gain(0.5f).mixToMono().countClipping();
+ *     p.apply(wav);
+ */
+class WavProcessor {
+public:
+
+    // Default Constructor
+    // Creates an empty chain, which just copies the samples
+    WavProcessor();
+
+    // Chain operations
+    // Each appends a step to the chain and returns the processor for chaining
+    WavProcessor &gain(float factor); // Multiply all channels by factor
+    WavProcessor &removeDCOffset(); // Subtract the mean of each channel
+    WavProcessor &mixToMono(); // Average all channels into one
+    WavProcessor &remapChannels(const std::vector<int> &map); // Output channel i is input channel map[i]
+    WavProcessor &extractChannel(int channel); // Keep only one channel
+
+    // Count output samples whose magnitude reaches threshold
+    // Checked on the output of the whole chain during the same pass
+    WavProcessor &countClipping(float threshold = 1.0f);
+
+    // Remove all operations from the chain
+    void clear();
+
+    // Number of channels the chain produces from in_channels input channels
+    uint16_t getOutputChannels(uint16_t in_channels);
+
+    // Apply the chain to a loaded wav file, replacing its samples
+    void apply(WavFile &w);
+
+    // Apply the chain to raw channel arrays
+    // out must hold getOutputChannels(in_channels) arrays of length samples, and must not alias in
+    void process(float **in, uint16_t in_channels, uint32_t length, float **out);
+
+    // Number of clipped samples found by the last apply/process, if countClipping was requested
+    uint64_t getClippedSamples();
+
+private:
+    enum class Step {
+        Gain,
+        RemoveDCOffset,
+        MixToMono,
+        Remap
+    };
+
+    struct Operation {
+        Step step;
+        float factor;
+        std::vector<int> map;
+    };
+
+    // Collapses the chain into matrix (out x in, row major) and offset (out)
+    void compile(float **in, uint16_t in_channels, uint32_t length,
+                 std::vector<float> &matrix, std::vector<float> &offset);
+
+    std::vector<Operation> operations;
+    bool count_clipping;
+    float clip_threshold;
+    uint64_t clipped_samples;
+};
+
+#endif /* WavProcessor_hpp */
@@ -0,0 +1,314 @@
+//
+//  WavResampler.cpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavResampler.hpp"
+#include "WavParallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+// Filter design parameters
+// The pass band ends at rolloff times the lower Nyquist frequency, beta 8 gives about 80 dB of stop band
+static const double rolloff = 0.9;
+static const double kaiser_beta = 8.0;
+
+// Input frames per block when resampling a whole file
+static const uint32_t file_block_size = 1 << 16;
+
+// Greatest common divisor, to reduce the rate ratio
+static uint32_t gcd(uint32_t a, uint32_t b){
+    while(b != 0){
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x){
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 50; ++k){
+        term *= (x/(2.0*k))*(x/(2.0*k));
+        sum += term;
+        if(term < sum*1e-12){
+            break;
+        }
+    }
+    return sum;
+}
+
+// Inner product of a filter phase and the input
+// Eight independent accumulators so the compiler can keep them in one or two vector registers
+static inline float dotProduct(const float * __restrict a, const float * __restrict b, uint32_t n){
+    float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint32_t i = 0;
+    for(; i + 8 <= n; i += 8){
+        for(int lane = 0; lane < 8; ++lane){
+            acc[lane] += a[i + lane]*b[i + lane];
+        }
+    }
+    float sum = ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]));
+    for(; i < n; ++i){
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+
+// Designs the filter bank for an up/down ratio
+std::shared_ptr<const WavResampler::FilterBank> WavResampler::designFilterBank(uint32_t up, uint32_t down, uint32_t taps){
+    std::shared_ptr<FilterBank> bank(new FilterBank());
+    bank->up = up;
+    bank->down = down;
+
+    // When decimating, the cut off is lower than the input Nyquist, so the filter needs more taps
+    uint64_t phase_taps = ((uint64_t)taps*std::max(up, down) + up - 1)/up;
+    phase_taps = (phase_taps + 7)/8*8;
+    bank->taps = (uint32_t)phase_taps;
+
+    // The prototype is one short of filling every phase, so its length is odd and its center
+    // lands on a whole upsampled sample. The last coefficient of the bank stays zero
+    const uint64_t length = (uint64_t)up*phase_taps - 1;
+    const uint64_t center = (length - 1)/2;
+    const double cutoff = 0.5*rolloff/std::max(up, down); // Cycles per sample at the upsampled rate
+    const double window_norm = besselI0(kaiser_beta);
+
+    // Start the stream center % down upsampled samples in, so that the delay is a whole number of outputs
+    bank->delay = (uint32_t)(center/down);
+    bank->offset = (uint32_t)(center % down);
+
+    bank->coefficients.assign(length + 1, 0.0f);
+    for(uint64_t n = 0; n < length; ++n){
+        double t = (double)n - (double)center;
+        double sinc = (t == 0) ? 1.0 : std::sin(2.0*M_PI*cutoff*t)/(2.0*M_PI*cutoff*t);
+        double r = t/center;
+        double window = besselI0(kaiser_beta*std::sqrt(std::max(0.0, 1.0 - r*r)))/window_norm;
+
+        // Gain of up makes up for the zeros inserted by interpolation
+        double h = up*2.0*cutoff*sinc*window;
+
+        // Coefficient n belongs to phase n % up, as tap n / up
+        // Taps are stored reversed so a phase lines up with the input oldest sample first
+        uint64_t phase = n % up;
+        uint64_t tap = n / up;
+        bank->coefficients[phase*phase_taps + (phase_taps - 1 - tap)] = (float)h;
+    }
+
+    return bank;
+}
+
+// Returns the shared filter bank for a conversion, building it if needed
+std::shared_ptr<const WavResampler::FilterBank> WavResampler::getFilterBank(uint32_t in_rate, uint32_t out_rate, uint32_t taps){
+    static std::mutex lock;
+    static std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::shared_ptr<const FilterBank> > cache;
+    static bool common_built = false;
+
+    if(in_rate == 0 || out_rate == 0){
+        throw std::invalid_argument("WavResampler Error: Sample rate must not be zero!");
+    }
+    if(taps == 0){
+        throw std::invalid_argument("WavResampler Error: Filter needs at least one tap!");
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    if(!common_built){
+        common_built = true;
+        static const uint32_t common[][2] = {
+            {44100, 48000},
+            {48000, 44100},
+            {96000, 48000},
+            {88200, 48000},
+            {32000, 48000},
+            {22050, 48000},
+            {16000, 48000}
+        };
+        for(auto &rates : common){
+            uint32_t divisor = gcd(rates[0], rates[1]);
+            uint32_t up = rates[1]/divisor;
+            uint32_t down = rates[0]/divisor;
+            cache[std::make_tuple(up, down, 64u)] = designFilterBank(up, down, 64);
+        }
+    }
+
+    uint32_t divisor = gcd(in_rate, out_rate);
+    uint32_t up = out_rate/divisor;
+    uint32_t down = in_rate/divisor;
+
+    auto key = std::make_tuple(up, down, taps);
+    auto found = cache.find(key);
+    if(found != cache.end()){
+        return found->second;
+    }
+
+    auto bank = designFilterBank(up, down, taps);
+    cache[key] = bank;
+    return bank;
+}
+
+// Build and cache the filter bank for a conversion ahead of time
+void WavResampler::prepare(uint32_t in_rate, uint32_t out_rate, uint32_t taps){
+    getFilterBank(in_rate, out_rate, taps);
+}
+
+// Constructor
+WavResampler::WavResampler(uint32_t in_rate, uint32_t out_rate, uint16_t channels, uint32_t taps){
+    this->in_rate = in_rate;
+    this->out_rate = out_rate;
+    num_channels = channels;
+    bank = getFilterBank(in_rate, out_rate, taps);
+    reset();
+}
+
+// Clear the stream history, as if no samples had been processed
+void WavResampler::reset(){
+    const uint32_t keep = bank->taps - 1;
+    history.assign(num_channels, std::vector<float>(keep, 0.0f));
+    position = keep + bank->offset/bank->up;
+    phase = bank->offset % bank->up;
+}
+
+uint32_t WavResampler::getInputRate(){
+    return in_rate;
+}
+
+uint32_t WavResampler::getOutputRate(){
+    return out_rate;
+}
+
+// Upper bound of the samples process() produces from frames input samples
+uint32_t WavResampler::getMaxOutput(uint32_t frames){
+    return (uint32_t)(((uint64_t)frames*bank->up + bank->down - 1)/bank->down + 1);
+}
+
+// Delay introduced by the filter, in output samples
+uint32_t WavResampler::getLatency(){
+    return bank->delay;
+}
+
+// Resample one block of a stream
+uint32_t WavResampler::process(float **in, uint32_t frames, float **out){
+    const uint32_t up = bank->up;
+    const uint32_t down = bank->down;
+    const uint32_t taps = bank->taps;
+    const uint32_t keep = taps - 1;
+    const uint64_t end = (uint64_t)keep + frames;
+    const float *coefficients = bank->coefficients.data();
+
+    // Every channel steps through the same positions and phases, so count the outputs once
+    uint32_t produced = 0;
+    uint64_t next_position = position;
+    uint64_t next_phase = phase;
+    while(next_position < end){
+        ++produced;
+        next_phase += down;
+        next_position += next_phase/up;
+        next_phase %= up;
+    }
+
+    const uint64_t start_position = position;
+    const uint64_t start_phase = phase;
+
+    unsigned int workers = workerCount((uint64_t)produced*taps*num_channels, 1 << 18);
+    parallelFor(num_channels, workers, [&](unsigned int, uint32_t begin, uint32_t stop){
+        for(uint32_t channel = begin; channel < stop; ++channel){
+            std::vector<float> &buffer = history[channel];
+            buffer.resize(keep);
+            buffer.insert(buffer.end(), in[channel], in[channel] + frames);
+
+            const float *samples = buffer.data();
+            float *dst = out[channel];
+            uint64_t p = start_position;
+            uint64_t ph = start_phase;
+            for(uint32_t n = 0; n < produced; ++n){
+                dst[n] = dotProduct(coefficients + ph*taps, samples + p - keep, taps);
+                ph += down;
+                p += ph/up;
+                ph %= up;
+            }
+
+            // Keep the newest taps-1 samples for the next block
+            buffer.erase(buffer.begin(), buffer.begin() + frames);
+        }
+    });
+
+    position = next_position - frames;
+    phase = next_phase;
+    return produced;
+}
+
+// Resample a loaded wav file in place
+void WavResampler::resample(WavFile &w, uint32_t out_rate, uint32_t taps){
+    const uint32_t in_rate = w.getSampleRate();
+    if(in_rate == out_rate){
+        return;
+    }
+
+    const uint16_t channels = w.getNumChannels();
+    const uint32_t length = w.getNumSamples();
+    float **data = w.getData();
+
+    WavResampler r(in_rate, out_rate, channels, taps);
+    const uint64_t out_length = ((uint64_t)length*out_rate + in_rate - 1)/in_rate;
+    if(out_length > UINT32_MAX){
+        throw std::overflow_error("WavResampler Error: Resampled file is too long!");
+    }
+
+    // Scratch for one block of output, and zeros to flush the filter with
+    const uint32_t block_output = r.getMaxOutput(file_block_size);
+    std::vector<std::vector<float> > scratch(channels, std::vector<float>(block_output));
+    std::vector<float *> scratch_ptrs(channels);
+    std::vector<float> zeros(file_block_size, 0.0f);
+    std::vector<float *> zero_ptrs(channels, zeros.data());
+    std::vector<float *> in_ptrs(channels);
+    for(int channel = 0; channel < channels; ++channel){
+        scratch_ptrs[channel] = scratch[channel].data();
+    }
+
+    float **out = new float*[channels];
+    for(int channel = 0; channel < channels; ++channel){
+        out[channel] = new float[out_length];
+    }
+
+    // Drop the first latency outputs so the result lines up with the input
+    uint64_t skip = r.getLatency();
+    uint64_t written = 0;
+    uint32_t consumed = 0;
+
+    while(written < out_length){
+        uint32_t frames;
+        float **src;
+        if(consumed < length){
+            frames = std::min(file_block_size, length - consumed);
+            for(int channel = 0; channel < channels; ++channel){
+                in_ptrs[channel] = data[channel] + consumed;
+            }
+            src = in_ptrs.data();
+            consumed += frames;
+        } else {
+            frames = file_block_size;
+            src = zero_ptrs.data();
+        }
+
+        uint32_t produced = r.process(src, frames, scratch_ptrs.data());
+        uint32_t first = (uint32_t)std::min<uint64_t>(skip, produced);
+        skip -= first;
+        uint32_t count = (uint32_t)std::min<uint64_t>(produced - first, out_length - written);
+        for(int channel = 0; channel < channels; ++channel){
+            std::copy(scratch[channel].begin() + first, scratch[channel].begin() + first + count, out[channel] + written);
+        }
+        written += count;
+    }
+
+    w.replaceData(out, channels, (uint32_t)out_length);
+    w.setSampleRate(out_rate);
+}
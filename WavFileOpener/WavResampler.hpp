@@ -0,0 +1,86 @@
+//
+//  WavResampler.hpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavResampler_hpp
+#define WavResampler_hpp
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "WavFile.hpp"
+
+/* WavResampler class
+ *
+ * Polyphase sample rate converter
+ *
+ * The ratio out_rate/in_rate is reduced to L/M, and a Kaiser windowed sinc low pass is split
+ * into L phases of taps coefficients each. Every output sample is then one inner product
+ * between a phase and the most recent input samples. Filter banks are built once per ratio
+ * and shared between resamplers, see prepare().
+ *
+ * Works either on a whole WavFile (resample) or block by block on a stream (process),
+ * with the channels of each block processed in parallel.
+ */
+class WavResampler {
+public:
+
+    // Constructor
+    // taps is the filter length per phase at the lower of the two rates, rounded up to a multiple of 8
+    WavResampler(uint32_t in_rate, uint32_t out_rate, uint16_t channels, uint32_t taps = 64);
+
+    // Clear the stream history, as if no samples had been processed
+    void reset();
+
+    // Resample one block of a stream
+    // in holds channels arrays of frames samples, out holds channels arrays of at least
+    // getMaxOutput(frames) samples. Returns the number of samples written per channel
+    uint32_t process(float **in, uint32_t frames, float **out);
+
+    // Upper bound of the samples process() produces from frames input samples
+    uint32_t getMaxOutput(uint32_t frames);
+
+    // Delay introduced by the filter, in output samples
+    // Feed this many output samples worth of zeros at the end of a stream to flush the filter
+    uint32_t getLatency();
+
+    uint32_t getInputRate();
+    uint32_t getOutputRate();
+
+    // Resample a loaded wav file in place
+    // The result is time aligned with the input, the filter delay is removed
+    static void resample(WavFile &w, uint32_t out_rate, uint32_t taps = 64);
+
+    // Build and cache the filter bank for a conversion ahead of time
+    // Common ratios (44.1k and 96k to 48k, 48k to 44.1k) are built on first use of any resampler
+    static void prepare(uint32_t in_rate, uint32_t out_rate, uint32_t taps = 64);
+
+private:
+    struct FilterBank {
+        uint32_t up; // L, interpolation factor
+        uint32_t down; // M, decimation factor
+        uint32_t taps; // Coefficients per phase
+        uint32_t delay; // Filter delay in whole output samples
+        uint32_t offset; // Upsampled samples to start the stream at, so the delay comes out whole
+        std::vector<float> coefficients; // up phases of taps each, reversed so they line up with the input
+    };
+
+    static std::shared_ptr<const FilterBank> getFilterBank(uint32_t in_rate, uint32_t out_rate, uint32_t taps);
+    static std::shared_ptr<const FilterBank> designFilterBank(uint32_t up, uint32_t down, uint32_t taps);
+
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint16_t num_channels;
+    std::shared_ptr<const FilterBank> bank;
+
+    uint64_t position; // Index of the newest input sample of the next output, into history + block
+    uint64_t phase; // Filter phase of the next output
+    std::vector<std::vector<float> > history; // Per channel, the last taps-1 input samples followed by the current block
+};
+
+#endif /* WavResampler_hpp */
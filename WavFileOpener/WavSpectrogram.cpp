@@ -0,0 +1,249 @@
+//
+//  WavSpectrogram.cpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#include "WavSpectrogram.hpp"
+#include "WavParallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Complex FFTs run side by side in a batch, one per vector lane
+// Each carries two real frames, one in the real part and one in the imaginary part
+static const uint32_t lanes = 8;
+static const uint32_t frames_per_batch = 2*lanes;
+
+// Constructor
+// fft_size must be a power of two, hop must not be zero
+WavSpectrogram::WavSpectrogram(uint32_t fft_size, uint32_t hop, Window window, Output output){
+    if(fft_size < 2 || (fft_size & (fft_size - 1)) != 0){
+        throw std::invalid_argument("WavSpectrogram Error: FFT size must be a power of two!");
+    }
+    if(hop == 0){
+        throw std::invalid_argument("WavSpectrogram Error: Hop size must not be zero!");
+    }
+
+    this->fft_size = fft_size;
+    this->hop = hop;
+    this->output = output;
+    skip = 0;
+
+    log2_size = 0;
+    while((1u << log2_size) < fft_size){
+        ++log2_size;
+    }
+
+    // Window, periodic so overlapping frames sum evenly
+    this->window.resize(fft_size);
+    for(uint32_t n = 0; n < fft_size; ++n){
+        double x = 2.0*M_PI*n/fft_size;
+        double w = 1.0;
+        switch(window){
+            case Window::Rectangular:
+                w = 1.0;
+                break;
+            case Window::Hann:
+                w = 0.5 - 0.5*std::cos(x);
+                break;
+            case Window::Hamming:
+                w = 0.54 - 0.46*std::cos(x);
+                break;
+            case Window::Blackman:
+                w = 0.42 - 0.5*std::cos(x) + 0.08*std::cos(2.0*x);
+                break;
+        }
+        this->window[n] = (float)w;
+    }
+
+    // Bit reversed order, applied while loading frames into the workspace
+    bit_reverse.resize(fft_size);
+    for(uint32_t n = 0; n < fft_size; ++n){
+        uint32_t reversed = 0;
+        for(uint32_t bit = 0; bit < log2_size; ++bit){
+            if(n & (1u << bit)){
+                reversed |= 1u << (log2_size - 1 - bit);
+            }
+        }
+        bit_reverse[n] = reversed;
+    }
+
+    // Twiddle factors for every stage, e^(-2*pi*i*j/len) for j < len/2
+    for(uint32_t len = 2; len <= fft_size; len <<= 1){
+        for(uint32_t j = 0; j < len/2; ++j){
+            double angle = -2.0*M_PI*j/len;
+            twiddle_re.push_back((float)std::cos(angle));
+            twiddle_im.push_back((float)std::sin(angle));
+        }
+    }
+
+    // Real and imaginary planes of a batch for each thread
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    workspaces.assign(threads, std::vector<float>((size_t)2*fft_size*lanes));
+}
+
+uint32_t WavSpectrogram::getFFTSize(){
+    return fft_size;
+}
+
+uint32_t WavSpectrogram::getHop(){
+    return hop;
+}
+
+// Number of values per frame, fft_size/2 + 1
+uint32_t WavSpectrogram::getNumBins(){
+    return fft_size/2 + 1;
+}
+
+// Number of frames a signal of length samples produces
+uint32_t WavSpectrogram::getNumFrames(uint32_t length){
+    if(length < fft_size){
+        return 0;
+    }
+    return 1 + (length - fft_size)/hop;
+}
+
+// Transforms up to 2*lanes frames on one workspace
+void WavSpectrogram::computeBatch(float *workspace, const float *samples, uint32_t frames, float *out){
+    const uint32_t n_fft = fft_size;
+    const uint32_t bins = getNumBins();
+    float * __restrict re = workspace;
+    float * __restrict im = workspace + (size_t)n_fft*lanes;
+
+    // Load windowed frames in bit reversed order, interleaved by lane
+    // Frame 2l goes in the real part of lane l, frame 2l+1 in the imaginary part
+    // Lanes without a frame are zeroed
+    for(uint32_t lane = 0; lane < lanes; ++lane){
+        uint32_t first = 2*lane;
+        uint32_t second = 2*lane + 1;
+        const float *a = (first < frames) ? samples + (size_t)first*hop : NULL;
+        const float *b = (second < frames) ? samples + (size_t)second*hop : NULL;
+        for(uint32_t n = 0; n < n_fft; ++n){
+            size_t index = (size_t)bit_reverse[n]*lanes + lane;
+            re[index] = a ? a[n]*window[n] : 0.0f;
+            im[index] = b ? b[n]*window[n] : 0.0f;
+        }
+    }
+
+    // Iterative radix 2 butterflies, every lane at once
+    const float *tw_re = twiddle_re.data();
+    const float *tw_im = twiddle_im.data();
+    for(uint32_t len = 2; len <= n_fft; len <<= 1){
+        const uint32_t half = len/2;
+        for(uint32_t start = 0; start < n_fft; start += len){
+            for(uint32_t j = 0; j < half; ++j){
+                const float wr = tw_re[j];
+                const float wi = tw_im[j];
+                float * __restrict top_re = re + (size_t)(start + j)*lanes;
+                float * __restrict top_im = im + (size_t)(start + j)*lanes;
+                float * __restrict bottom_re = re + (size_t)(start + j + half)*lanes;
+                float * __restrict bottom_im = im + (size_t)(start + j + half)*lanes;
+                for(uint32_t lane = 0; lane < lanes; ++lane){
+                    float tr = wr*bottom_re[lane] - wi*bottom_im[lane];
+                    float ti = wr*bottom_im[lane] + wi*bottom_re[lane];
+                    bottom_re[lane] = top_re[lane] - tr;
+                    bottom_im[lane] = top_im[lane] - ti;
+                    top_re[lane] += tr;
+                    top_im[lane] += ti;
+                }
+            }
+        }
+        tw_re += half;
+        tw_im += half;
+    }
+
+    // Separate the two real frames of each lane and write their bins
+    // With Z = FFT(a + ib): A[k] = (Z[k] + conj(Z[N-k]))/2 and B[k] = (Z[k] - conj(Z[N-k]))/2i
+    const bool power = output == Output::Power;
+    for(uint32_t lane = 0; lane < lanes; ++lane){
+        uint32_t first = 2*lane;
+        uint32_t second = 2*lane + 1;
+        if(first >= frames){
+            break;
+        }
+        float *out_a = out + (size_t)first*bins;
+        float *out_b = (second < frames) ? out + (size_t)second*bins : NULL;
+        for(uint32_t k = 0; k < bins; ++k){
+            size_t i = (size_t)k*lanes + lane;
+            size_t j = (size_t)((n_fft - k) & (n_fft - 1))*lanes + lane;
+            float ar = 0.5f*(re[i] + re[j]);
+            float ai = 0.5f*(im[i] - im[j]);
+            float a_power = ar*ar + ai*ai;
+            out_a[k] = power ? a_power : std::sqrt(a_power);
+            if(out_b){
+                float br = 0.5f*(im[i] + im[j]);
+                float bi = -0.5f*(re[i] - re[j]);
+                float b_power = br*br + bi*bi;
+                out_b[k] = power ? b_power : std::sqrt(b_power);
+            }
+        }
+    }
+}
+
+// Transforms frames starting every hop samples from samples, into out
+void WavSpectrogram::computeFrames(const float *samples, uint32_t frames, float *out){
+    const uint32_t bins = getNumBins();
+    const uint32_t batches = (frames + frames_per_batch - 1)/frames_per_batch;
+    unsigned int workers = std::min<unsigned int>((unsigned int)workspaces.size(),
+                                                  workerCount((uint64_t)frames*fft_size*log2_size, 1 << 18));
+
+    parallelFor(batches, workers, [&](unsigned int worker, uint32_t begin, uint32_t end){
+        float *workspace = workspaces[worker].data();
+        for(uint32_t batch = begin; batch < end; ++batch){
+            uint32_t first = batch*frames_per_batch;
+            uint32_t count = std::min(frames_per_batch, frames - first);
+            computeBatch(workspace, samples + (size_t)first*hop, count, out + (size_t)first*bins);
+        }
+    });
+}
+
+// Analyze a whole signal
+// out must hold getNumFrames(length)*getNumBins() values
+void WavSpectrogram::analyze(const float *samples, uint32_t length, float *out){
+    computeFrames(samples, getNumFrames(length), out);
+}
+
+// Analyze one channel of a loaded wav file
+std::vector<float> WavSpectrogram::analyze(WavFile &w, int channel){
+    const float *samples = w[channel];
+    uint32_t length = w.getNumSamples();
+    std::vector<float> out((size_t)getNumFrames(length)*getNumBins());
+    analyze(samples, length, out.data());
+    return out;
+}
+
+// Analyze a stream, block by block
+// Frames completed by this block are appended to out, returns the number of frames added
+uint32_t WavSpectrogram::process(const float *block, uint32_t length, std::vector<float> &out){
+    // With hop larger than fft_size, some samples between frames are never used
+    uint32_t skipped = std::min(skip, length);
+    skip -= skipped;
+    pending.insert(pending.end(), block + skipped, block + length);
+
+    uint32_t frames = getNumFrames((uint32_t)pending.size());
+    if(frames == 0){
+        return 0;
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + (size_t)frames*getNumBins());
+    computeFrames(pending.data(), frames, out.data() + offset);
+
+    // Keep the samples the next frame still needs
+    size_t consumed = (size_t)frames*hop;
+    if(consumed > pending.size()){
+        skip = (uint32_t)(consumed - pending.size());
+        consumed = pending.size();
+    }
+    pending.erase(pending.begin(), pending.begin() + consumed);
+    return frames;
+}
+
+// Drop any buffered stream samples
+void WavSpectrogram::reset(){
+    pending.clear();
+    skip = 0;
+}
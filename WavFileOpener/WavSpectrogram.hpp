@@ -0,0 +1,93 @@
+//
+//  WavSpectrogram.hpp
+//  WavFileOpener
+//
+//  Created by John Asper on 2016/8/10.
+//  Copyright © 2016 John Asper. All rights reserved.
+//
+
+#ifndef WavSpectrogram_hpp
+#define WavSpectrogram_hpp
+
+#include <cstdint>
+#include <vector>
+
+#include "WavFile.hpp"
+
+/* WavSpectrogram class
+ *
+ * Short time Fourier transform of a channel, as magnitude or power per frame and bin
+ *
+ * The window, twiddle factors and per thread workspaces are set up once in the constructor.
+ * Frames are transformed in batches, interleaved so every butterfly works on a whole batch
+ * at once (one frame per vector lane), with two real frames packed into each complex lane.
+ * Batches are split across threads.
+ *
+ * Output is a contiguous matrix, one row of getNumBins() values per frame.
+ * Frames start every hop samples, only frames that fit entirely in the signal are produced.
+ */
+class WavSpectrogram {
+public:
+
+    enum class Window {
+        Rectangular,
+        Hann,
+        Hamming,
+        Blackman
+    };
+
+    enum class Output {
+        Magnitude,
+        Power
+    };
+
+    // Constructor
+    // fft_size must be a power of two, hop must not be zero
+    WavSpectrogram(uint32_t fft_size, uint32_t hop, Window window = Window::Hann, Output output = Output::Magnitude);
+
+    uint32_t getFFTSize();
+    uint32_t getHop();
+
+    // Number of values per frame, fft_size/2 + 1
+    uint32_t getNumBins();
+
+    // Number of frames a signal of length samples produces
+    uint32_t getNumFrames(uint32_t length);
+
+    // Analyze a whole signal
+    // out must hold getNumFrames(length)*getNumBins() values
+    void analyze(const float *samples, uint32_t length, float *out);
+
+    // Analyze one channel of a loaded wav file
+    std::vector<float> analyze(WavFile &w, int channel);
+
+    // Analyze a stream, block by block
+    // Frames completed by this block are appended to out, returns the number of frames added
+    uint32_t process(const float *block, uint32_t length, std::vector<float> &out);
+
+    // Drop any buffered stream samples
+    void reset();
+
+private:
+    // Transforms frames starting every hop samples from samples, into out
+    void computeFrames(const float *samples, uint32_t frames, float *out);
+
+    // Transforms up to 2*lanes frames on one workspace
+    void computeBatch(float *workspace, const float *samples, uint32_t frames, float *out);
+
+    uint32_t fft_size;
+    uint32_t hop;
+    uint32_t log2_size;
+    Output output;
+
+    std::vector<float> window;
+    std::vector<uint32_t> bit_reverse;
+    std::vector<float> twiddle_re; // Stage by stage, len/2 factors for each butterfly size len
+    std::vector<float> twiddle_im;
+
+    std::vector<std::vector<float> > workspaces; // One per thread
+    std::vector<float> pending; // Stream samples not yet consumed by a frame
+    uint32_t skip; // Stream samples to drop before the next frame starts
+};
+
+#endif /* WavSpectrogram_hpp */